@@ -0,0 +1,144 @@
+#include "BufferPool.hh"
+
+#include <mutex>
+
+using namespace base;
+
+// all live pools, only touched on thread start/exit and by GetStats
+static std::mutex gPoolsMutex;
+static vector<BufferPool*> gPools;
+
+// counters of pools whose thread has exited
+static std::atomic<uint64_t> gRetiredHits(0);
+static std::atomic<uint64_t> gRetiredMisses(0);
+
+BufferPool* BufferPool::GetInstance()
+{
+    static thread_local BufferPool pool;
+    return &pool;
+}
+
+void BufferPool::GetStats(uint64_t& hits, uint64_t& misses)
+{
+    std::lock_guard<std::mutex> lock(gPoolsMutex);
+
+    hits = gRetiredHits.load(std::memory_order_relaxed);
+    misses = gRetiredMisses.load(std::memory_order_relaxed);
+    for (auto pool : gPools) {
+        hits += pool->_hits.load(std::memory_order_relaxed);
+        misses += pool->_misses.load(std::memory_order_relaxed);
+    }
+}
+
+BufferPool::BufferPool() : _hits(0), _misses(0)
+{
+    std::lock_guard<std::mutex> lock(gPoolsMutex);
+    gPools.push_back(this);
+}
+
+BufferPool::~BufferPool()
+{
+    for (auto& freeList : _freeList) {
+        for (auto data : freeList) {
+            delete[] data;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(gPoolsMutex);
+    gRetiredHits += _hits.load(std::memory_order_relaxed);
+    gRetiredMisses += _misses.load(std::memory_order_relaxed);
+    for (auto it = gPools.begin(); it != gPools.end(); ++it) {
+        if (*it == this) {
+            gPools.erase(it);
+            break;
+        }
+    }
+}
+
+int BufferPool::ClassOf(size_t size)
+{
+    int idx = 0;
+    size_t classSize = kMinClassSize;
+
+    while (classSize < size) {
+        classSize <<= 1;
+        idx += 1;
+    }
+    return idx;
+}
+
+char* BufferPool::Allocate(size_t size, size_t& capacity)
+{
+    int idx = ClassOf(size);
+    if (idx >= kClassCount) {
+        capacity = size;
+        return new char[size];
+    }
+
+    capacity = kMinClassSize << idx;
+
+    // single writer, no need for an atomic read-modify-write
+    auto& freeList = _freeList[idx];
+    if (!freeList.empty()) {
+        char* data = freeList.back();
+        freeList.pop_back();
+        _hits.store(_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return data;
+    }
+
+    _misses.store(_misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return new char[capacity];
+}
+
+void BufferPool::Release(char* data, size_t capacity)
+{
+    int idx = ClassOf(capacity);
+    if (idx >= kClassCount || (_freeList[idx].size() + 1) * capacity > kMaxCachedBytes) {
+        delete[] data;
+        return;
+    }
+    _freeList[idx].push_back(data);
+}
+
+Buffer::Buffer() : _data(nullptr), _size(0)
+{
+
+}
+
+Buffer::Buffer(size_t size) : _data(nullptr), _size(0)
+{
+    _data = BufferPool::GetInstance()->Allocate(size, _size);
+}
+
+Buffer::Buffer(Buffer&& r) : _data(r._data), _size(r._size)
+{
+    r._data = nullptr;
+    r._size = 0;
+}
+
+Buffer& Buffer::operator=(Buffer&& r)
+{
+    if (this != &r) {
+        Reset();
+        _data = r._data;
+        _size = r._size;
+        r._data = nullptr;
+        r._size = 0;
+    }
+    return *this;
+}
+
+Buffer::~Buffer()
+{
+    Reset();
+}
+
+void Buffer::Reset()
+{
+    if (_data != nullptr) {
+        // sessions are pinned to one thread, so this is the pool it came from
+        BufferPool::GetInstance()->Release(_data, _size);
+        _data = nullptr;
+        _size = 0;
+    }
+}
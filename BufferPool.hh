@@ -0,0 +1,69 @@
+#ifndef __BUFFER_POOL_HH__
+#define __BUFFER_POOL_HH__
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+using std::vector;
+
+namespace base
+{
+
+// per-thread pool of fixed size classes: 2K, 4K, ... 64K
+class BufferPool {
+public:
+    static const size_t kMinClassSize = 2048;
+    static const int kClassCount = 6;
+    static const size_t kMaxCachedBytes = 16 * 1024 * 1024;  // per class, per thread
+
+    // pool of the calling thread
+    static BufferPool* GetInstance();
+
+    // hit/miss counters summed over all threads
+    static void GetStats(uint64_t& hits, uint64_t& misses);
+
+    // size is rounded up to its size class, larger requests bypass the pool
+    char* Allocate(size_t size, size_t& capacity);
+    void Release(char* data, size_t capacity);
+private:
+    BufferPool();
+    ~BufferPool();
+    BufferPool(const BufferPool &r) = delete;   // non-copyable
+    BufferPool & operator=(const BufferPool &r) = delete;   // non-copyable
+
+    static int ClassOf(size_t size);
+private:
+    vector<char*> _freeList[kClassCount];
+    std::atomic<uint64_t> _hits;        // written by owner thread only, read by GetStats
+    std::atomic<uint64_t> _misses;
+};
+
+// buffer borrowed from the pool of the current thread, given back on destruction
+class Buffer {
+public:
+    Buffer();
+    explicit Buffer(size_t size);
+    Buffer(Buffer&& r);
+    Buffer& operator=(Buffer&& r);
+    ~Buffer();
+
+    void Reset();   // give back to pool
+
+    char* Data() { return _data; }
+    size_t Size() const { return _size; }
+    bool Empty() const { return _data == nullptr; }
+    char& operator[](size_t i) { return _data[i]; }
+private:
+    Buffer(const Buffer &r) = delete;   // non-copyable
+    Buffer & operator=(const Buffer &r) = delete;   // non-copyable
+private:
+    char* _data;
+    size_t _size;
+};
+
+}
+
+#endif
@@ -0,0 +1,39 @@
+#include "HandlerAllocator.hh"
+
+#include <new>
+
+HandlerMemory::HandlerMemory() : used_(0), fallbacks_(0)
+{
+
+}
+
+HandlerMemory::~HandlerMemory()
+{
+
+}
+
+void* HandlerMemory::allocate(size_t size)
+{
+    if (size <= kSlotSize) {
+        for (int i = 0; i < kSlotCount; i += 1) {
+            if (!(used_ & (1u << i))) {
+                used_ |= (1u << i);
+                return slots_[i];
+            }
+        }
+    }
+
+    fallbacks_ += 1;
+    return ::operator new(size);
+}
+
+void HandlerMemory::deallocate(void* pointer)
+{
+    unsigned char* p = static_cast<unsigned char*>(pointer);
+
+    if (p >= slots_[0] && p < slots_[0] + sizeof(slots_)) {
+        used_ &= ~(1u << ((p - slots_[0]) / kSlotSize));
+        return;
+    }
+    ::operator delete(pointer);
+}
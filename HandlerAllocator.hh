@@ -0,0 +1,79 @@
+#ifndef __HANDLER_ALLOCATOR_HH__
+#define __HANDLER_ALLOCATOR_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include <boost/asio.hpp>
+
+// fixed slots for completion handler state, owned by a Session. asio frees an
+// operation's memory before invoking its handler, so a handler that starts the
+// next operation reuses the slot it just released.
+class HandlerMemory {
+public:
+    static const size_t kSlotSize = 256;
+    static const int kSlotCount = 4;    // read && write for both directions
+
+    HandlerMemory();
+    ~HandlerMemory();
+
+    void* allocate(size_t size);
+    void deallocate(void* pointer);
+
+    uint64_t getFallbacks() const { return fallbacks_; }
+private:
+    HandlerMemory(const HandlerMemory &r) = delete;   // non-copyable
+    HandlerMemory & operator=(const HandlerMemory &r) = delete;   // non-copyable
+private:
+    alignas(std::max_align_t) unsigned char slots_[kSlotCount][kSlotSize];
+    uint32_t used_;         // bitmask of slots in use
+    uint64_t fallbacks_;    // allocations that went to the heap
+};
+
+// minimal allocator handed to asio through associated_allocator
+template <typename T>
+class HandlerAllocator {
+public:
+    typedef T value_type;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& r) : memory_(r.memory_) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(memory_.allocate(sizeof(T) * n)); }
+    void deallocate(T* pointer, size_t n) { memory_.deallocate(pointer); }
+
+    bool operator==(const HandlerAllocator& r) const { return &memory_ == &r.memory_; }
+    bool operator!=(const HandlerAllocator& r) const { return &memory_ != &r.memory_; }
+private:
+    template <typename> friend class HandlerAllocator;
+
+    HandlerMemory& memory_;
+};
+
+// wraps a completion handler so that asio allocates its state from HandlerMemory
+template <typename Handler>
+class AllocHandler {
+public:
+    typedef HandlerAllocator<Handler> allocator_type;
+
+    AllocHandler(HandlerMemory& memory, Handler handler) : memory_(memory), handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const { return allocator_type(memory_); }
+
+    template <typename... Args>
+    void operator()(Args&&... args) { handler_(std::forward<Args>(args)...); }
+private:
+    HandlerMemory& memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+inline AllocHandler<Handler> makeAllocHandler(HandlerMemory& memory, Handler handler)
+{
+    return AllocHandler<Handler>(memory, std::move(handler));
+}
+
+#endif
@@ -3,23 +3,60 @@
 
 #include <iostream>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 using namespace std;
 using namespace boost::asio;
 
 static const int kDefaultBufferSize = 4096;
+static const size_t kSpliceChunkSize = 65536;   // default pipe capacity
+
+int Session::defaultRelayMode_ = RELAY_SPLICE;
 
 Session::Session(tcp::socket inSocket, uint64_t sessionId) : sessionId_(sessionId), inSocket_(std::move(inSocket)), \
-    outSocket_(inSocket_.get_io_service()), resolver_(inSocket_.get_io_service()), inBuf_(kDefaultBufferSize), \
-    outBuf_(kDefaultBufferSize)
+    outSocket_(inSocket_.get_executor()), resolver_(inSocket_.get_executor()), inBuf_(kDefaultBufferSize), \
+    closedFlows_(0), relayMode_(RELAY_BUFFERED)
 {
     LOG_DEBUG("Session object created! sessionId: [%llu]", sessionId_);
 
+    for (int i = 0; i < 2; i += 1) {
+        Flow& flow = flows_[i];
+        flow.from = (i == 0) ? &inSocket_ : &outSocket_;
+        flow.to = (i == 0) ? &outSocket_ : &inSocket_;
+        flow.len[0] = flow.len[1] = 0;
+        flow.readIdx = flow.writeIdx = 0;
+        flow.reading = flow.writing = flow.eof = false;
+        flow.bytes = 0;
+        flow.pipe[0] = flow.pipe[1] = -1;
+        flow.piped = 0;
+    }
+
     // start();
 }
 
 Session::~Session()
 {
-    LOG_DEBUG("Session object destoryed! sessionId: [%llu]", sessionId_);
+    LOG_DEBUG("Session object destoryed! sessionId: [%llu], mode: [%s], up: [%llu] bytes, down: [%llu] bytes", \
+        sessionId_, relayMode_ == RELAY_SPLICE ? "splice" : "buffered", flows_[0].bytes, flows_[1].bytes);
+
+    for (auto& flow : flows_) {
+        if (flow.pipe[0] >= 0) {
+            close(flow.pipe[0]);
+            close(flow.pipe[1]);
+        }
+    }
+}
+
+void Session::SetRelayMode(int mode)
+{
+    defaultRelayMode_ = mode;
+}
+
+int Session::GetRelayMode()
+{
+    return defaultRelayMode_;
 }
 
 void Session::start()
@@ -54,7 +91,7 @@ void Session::readSocks5HandShake()
 
     auto self = shared_from_this();
 
-    inSocket_.async_receive(boost::asio::buffer(inBuf_), \
+    inSocket_.async_receive(boost::asio::buffer(inBuf_.Data(), inBuf_.Size()), \
         [self, this] (const boost::system::error_code& ec, size_t length)
         {
             if (!ec) {
@@ -94,7 +131,7 @@ void Session::writeSocks5HandShake()
     auto self = shared_from_this();
 
     // send handshake result back to client
-    inSocket_.async_send(boost::asio::buffer(inBuf_, 2), \
+    inSocket_.async_send(boost::asio::buffer(inBuf_.Data(), 2), \
         [this, self] (const boost::system::error_code& ec, std::size_t length) {
             if (!ec) {
                 LOG_DEBUG("%d bytes sent to client!", length);
@@ -147,7 +184,7 @@ void Session::readSocks5Request()
 {
     auto self = shared_from_this();
 
-    inSocket_.async_receive(boost::asio::buffer(inBuf_), 
+    inSocket_.async_receive(boost::asio::buffer(inBuf_.Data(), inBuf_.Size()), 
         [self, this] (const boost::system::error_code& ec, size_t length)
         {
             if (!ec) {
@@ -167,8 +204,11 @@ void Session::readSocks5Request()
                     }
                     // parse ip addr from request
                     this->remoteAddr_ = ip::address_v4(ntohl(*((uint32_t*)(&inBuf_[4])))).to_string();
-                    this->remotePort_ = std::to_string(ntohs(*((uint16_t*)(&inBuf_[7]))));
+                    this->remotePort_ = std::to_string(ntohs(*((uint16_t*)(&inBuf_[8]))));
                     LOG_DEBUG("addr: [%s], port: [%s]", remoteAddr_.c_str(), remotePort_.c_str());
+
+                    // numeric host, resolves without a dns query
+                    doResolve();
                 } else if (addressType == 0x03) {   // DOMAIN
                     uint8_t domainLen = inBuf_[4];
                     LOG_DEBUG("DomainLength: [%d]", domainLen);
@@ -179,7 +219,7 @@ void Session::readSocks5Request()
                             domainLen, length, (5 + domainLen + 2), sessionId_);
                         return;
                     }
-                    this->remoteAddr_ = std::string(inBuf_[5], domainLen);
+                    this->remoteAddr_ = std::string(&inBuf_[5], domainLen);
                     this->remotePort_ = std::to_string(ntohs(*((uint16_t*)(&inBuf_[5 + domainLen]))));
                     LOG_DEBUG("addr: [%s], port: [%s]", remoteAddr_.c_str(), remotePort_.c_str());
 
@@ -275,7 +315,7 @@ void Session::writeSocks5Resp()
     auto self = shared_from_this();
 
     // clear buffer
-    memset((void *)this->inBuf_.data(), 0x00, inBuf_.size());
+    memset((void *)this->inBuf_.Data(), 0x00, inBuf_.Size());
 
     uint32_t remoteIPAddr = this->outSocket_.remote_endpoint().address().to_v4().to_ulong();
     uint16_t remotePort = htons(this->outSocket_.remote_endpoint().port()); // convert to network endian
@@ -289,12 +329,12 @@ void Session::writeSocks5Resp()
     memcpy(&(inBuf_[8]), (void*)&remotePort, sizeof(remotePort));   // port
 
     // send back handshake
-    this->inSocket_.async_send(boost::asio::buffer(inBuf_, 10), \
+    this->inSocket_.async_send(boost::asio::buffer(inBuf_.Data(), 10), \
         [self, this] (const boost::system::error_code& ec, size_t length)
         {
             if (!ec) {
                 // goto stream phase, read both side first
-                doRead(0x03);
+                startRelay();
             } else {
                 LOG_ERROR("error occured while async_connect for writeSocks5Resp! error info: [%s], sessionId: [%llu], will close", ec.message().c_str(), sessionId_);
                 return;
@@ -303,28 +343,310 @@ void Session::writeSocks5Resp()
     );
 }
 
-void Session::doRead(int direction)
+void Session::startRelay()
 {
-    // read local side
-    if (direction & 0x1) {
+    boost::system::error_code ec;
 
+    // handshake is done, relay borrows buffers on demand
+    inBuf_.Reset();
+
+    // both modes read only after readiness, a blocking read would stall the thread
+    inSocket_.non_blocking(true, ec);
+    if (!ec) {
+        outSocket_.non_blocking(true, ec);
+    }
+    if (ec) {
+        LOG_ERROR("failed to set non-blocking mode! error info: [%s], sessionId: [%llu], will close", ec.message().c_str(), sessionId_);
+        doClose();
+        return;
     }
 
-    // read remote side
-    if (direction & 0x2) {
+    if (defaultRelayMode_ == RELAY_SPLICE) {
+        bool ok = true;
+
+        for (auto& flow : flows_) {
+            if (pipe2(flow.pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+                LOG_WARN("pipe2 failed! errno: [%d], sessionId: [%llu], fallback to buffered relay", errno, sessionId_);
+                ok = false;
+                break;
+            }
+        }
 
+        if (ok) {
+            relayMode_ = RELAY_SPLICE;
+            doSplice(0x03);
+            return;
+        }
+    }
+
+    relayMode_ = RELAY_BUFFERED;
+    doRead(0x03);
+}
+
+/*
+Stream phase, each direction owns two buffers: while one buffer is being
+written to the peer, the next read goes into the other one. Reading stops
+only when both buffers are full, so a slow writer throttles its own
+direction and never the opposite one.
+
+Reads wait for readiness first and borrow a buffer from the pool only when
+there is data to read, a buffer goes back to the pool as soon as it has
+been written. An idle session holds no buffer at all.
+*/
+void Session::doRead(int direction)
+{
+    for (int i = 0; i < 2; i += 1) {
+        if (!(direction & (1 << i))) {
+            continue;
+        }
+
+        Flow& flow = flows_[i];
+        int idx = flow.readIdx;
+        if (flow.reading || flow.eof || flow.len[idx] != 0) {
+            continue;
+        }
+
+        auto self = shared_from_this();
+        int dir = 1 << i;
+
+        flow.reading = true;
+        flow.from->async_wait(tcp::socket::wait_read, \
+            [self, this, dir, idx] (const boost::system::error_code& ec)
+            {
+                Flow& flow = flows_[dir >> 1];
+                flow.reading = false;
+
+                if (ec) {
+                    if (ec != boost::asio::error::operation_aborted) {
+                        LOG_DEBUG("error occured while async_wait for doRead! error info: [%s], sessionId: [%llu]", ec.message().c_str(), sessionId_);
+                        doClose();
+                    }
+                    return;
+                }
+
+                if (flow.buf[idx].Empty()) {
+                    flow.buf[idx] = base::Buffer(kDefaultBufferSize);
+                }
+
+                boost::system::error_code err;
+                size_t length = flow.from->read_some(boost::asio::buffer(flow.buf[idx].Data(), flow.buf[idx].Size()), err);
+
+                if (err) {
+                    flow.buf[idx].Reset();
+                    if (err == boost::asio::error::would_block || err == boost::asio::error::try_again) {
+                        doRead(dir);
+                    } else if (err == boost::asio::error::eof) {
+                        LOG_DEBUG("direction [%d] got eof, sessionId: [%llu]", dir, sessionId_);
+                        flow.eof = true;
+                        if (!flow.writing) {
+                            doShutdown(dir);
+                        }
+                    } else {
+                        LOG_DEBUG("error occured while read_some for doRead! error info: [%s], sessionId: [%llu]", err.message().c_str(), sessionId_);
+                        doClose();
+                    }
+                    return;
+                }
+
+                flow.len[idx] = length;
+                flow.readIdx = idx ^ 1;
+
+                if (!flow.writing) {
+                    flow.writeIdx = idx;
+                    doWrite(dir, length);
+                }
+                // keep reading into the other buffer while this one is being written
+                doRead(dir);
+            }
+        );
     }
 }
 
 void Session::doWrite(int direction, size_t length)
 {
-    // write remote side
-    if (direction & 0x1) {
+    for (int i = 0; i < 2; i += 1) {
+        if (!(direction & (1 << i))) {
+            continue;
+        }
+
+        Flow& flow = flows_[i];
+        int idx = flow.writeIdx;
+        auto self = shared_from_this();
+        int dir = 1 << i;
+
+        flow.writing = true;
+        boost::asio::async_write(*flow.to, boost::asio::buffer(flow.buf[idx].Data(), length), \
+            [self, this, dir, idx] (const boost::system::error_code& ec, size_t length)
+            {
+                Flow& flow = flows_[dir >> 1];
+                flow.writing = false;
+
+                if (ec) {
+                    if (ec != boost::asio::error::operation_aborted) {
+                        LOG_DEBUG("error occured while async_write for doWrite! error info: [%s], sessionId: [%llu]", ec.message().c_str(), sessionId_);
+                        doClose();
+                    }
+                    return;
+                }
+
+                flow.bytes += length;
+                flow.len[idx] = 0;
+                flow.buf[idx].Reset();
 
+                // the other buffer filled up while this one was being written
+                if (flow.len[idx ^ 1] != 0) {
+                    flow.writeIdx = idx ^ 1;
+                    doWrite(dir, flow.len[idx ^ 1]);
+                } else if (flow.eof) {
+                    doShutdown(dir);
+                    return;
+                }
+                // reading may have stopped because both buffers were full
+                doRead(dir);
+            }
+        );
+    }
+}
+
+/*
+Splice mode: wait until the source socket is readable, move what it holds
+into the direction's pipe, then drain the pipe into the destination
+socket. A direction waits for writability of its destination only while
+the pipe still holds data, so the two directions never block each other.
+*/
+void Session::doSplice(int direction)
+{
+    for (int i = 0; i < 2; i += 1) {
+        if (!(direction & (1 << i))) {
+            continue;
+        }
+
+        Flow& flow = flows_[i];
+        if (flow.reading || flow.eof) {
+            continue;
+        }
+
+        auto self = shared_from_this();
+        int dir = 1 << i;
+
+        flow.reading = true;
+        flow.from->async_wait(tcp::socket::wait_read, \
+            [self, this, dir] (const boost::system::error_code& ec)
+            {
+                Flow& flow = flows_[dir >> 1];
+                flow.reading = false;
+
+                if (ec) {
+                    if (ec != boost::asio::error::operation_aborted) {
+                        LOG_DEBUG("error occured while async_wait for doSplice! error info: [%s], sessionId: [%llu]", ec.message().c_str(), sessionId_);
+                        doClose();
+                    }
+                    return;
+                }
+
+                ssize_t n = splice(flow.from->native_handle(), NULL, flow.pipe[1], NULL, kSpliceChunkSize, \
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (n < 0) {
+                    if (errno == EAGAIN || errno == EINTR) {
+                        doSplice(dir);
+                    } else if (errno == EINVAL && flow.bytes == 0 && flow.piped == 0) {
+                        LOG_WARN("splice not supported, sessionId: [%llu], fallback to buffered relay", sessionId_);
+                        doRead(dir);
+                    } else {
+                        LOG_DEBUG("splice from socket failed! errno: [%d], sessionId: [%llu]", errno, sessionId_);
+                        doClose();
+                    }
+                    return;
+                }
+
+                if (n == 0) {
+                    LOG_DEBUG("direction [%d] got eof, sessionId: [%llu]", dir, sessionId_);
+                    flow.eof = true;
+                    if (flow.piped == 0) {
+                        doShutdown(dir);
+                    }
+                    return;
+                }
+
+                flow.piped += n;
+                doSpliceOut(dir);
+            }
+        );
+    }
+}
+
+void Session::doSpliceOut(int direction)
+{
+    Flow& flow = flows_[direction >> 1];
+
+    while (flow.piped > 0) {
+        ssize_t n = splice(flow.pipe[0], NULL, flow.to->native_handle(), NULL, flow.piped, \
+            SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            flow.piped -= n;
+            flow.bytes += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            break;
+        }
+        LOG_DEBUG("splice to socket failed! errno: [%d], sessionId: [%llu]", errno, sessionId_);
+        doClose();
+        return;
     }
 
-    // write local side
-    if (direction & 0x2) {
-        
+    if (flow.piped > 0) {
+        // destination is full, resume once it drains
+        auto self = shared_from_this();
+
+        flow.writing = true;
+        flow.to->async_wait(tcp::socket::wait_write, \
+            [self, this, direction] (const boost::system::error_code& ec)
+            {
+                flows_[direction >> 1].writing = false;
+
+                if (ec) {
+                    if (ec != boost::asio::error::operation_aborted) {
+                        LOG_DEBUG("error occured while async_wait for doSpliceOut! error info: [%s], sessionId: [%llu]", ec.message().c_str(), sessionId_);
+                        doClose();
+                    }
+                    return;
+                }
+                doSpliceOut(direction);
+            }
+        );
+        return;
     }
-}
\ No newline at end of file
+
+    if (flow.eof) {
+        doShutdown(direction);
+    } else {
+        doSplice(direction);
+    }
+}
+
+void Session::doShutdown(int direction)
+{
+    Flow& flow = flows_[direction >> 1];
+    boost::system::error_code ec;
+
+    // propagate half-close to the peer
+    flow.to->shutdown(tcp::socket::shutdown_send, ec);
+    closedFlows_ |= direction;
+
+    if (closedFlows_ == 0x03) {
+        doClose();
+    }
+}
+
+void Session::doClose()
+{
+    boost::system::error_code ec;
+
+    // pending handlers complete with operation_aborted and release the session
+    inSocket_.close(ec);
+    outSocket_.close(ec);
+}
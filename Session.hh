@@ -9,17 +9,29 @@
 
 #include <boost/asio.hpp>
 
+#include "BufferPool.hh"
+#include "HandlerAllocator.hh"
+
 using boost::asio::io_service;
 using boost::asio::ip::tcp;
 
 using std::string;
 using std::vector;
 
+// how payload is moved between inSocket_ and outSocket_ after the handshake
+enum RelayMode {
+    RELAY_BUFFERED,     // copy through user space buffers
+    RELAY_SPLICE,       // move through a pipe with splice(2), payload never enters user space
+};
+
 class Session : public std::enable_shared_from_this<Session> {
 public:
     Session(tcp::socket inSocket, uint64_t sessionId);
     ~Session();
     void start();
+
+    static void SetRelayMode(int mode);
+    static int GetRelayMode();
 private:
     void readSocks5HandShake();
     void writeSocks5HandShake();
@@ -31,6 +43,37 @@ private:
 
     void doRead(int direction);
     void doWrite(int direction, size_t length);
+    void startRelay();
+    void doSplice(int direction);
+    void doSpliceOut(int direction);
+    void doShutdown(int direction);
+    void doClose();
+private:
+    // relay handlers capture a plain this, the session is kept alive by
+    // self_ while any of them is pending, which saves the atomic refcount
+    // traffic of capturing a shared_ptr per operation
+    struct OpGuard {
+        explicit OpGuard(Session* session) : session_(session) {}
+        ~OpGuard();
+        Session* session_;
+    };
+
+    // relay state of one direction, flows_[0]: client -> remote, flows_[1]: remote -> client
+    struct Flow {
+        tcp::socket* from;          // socket to read from
+        tcp::socket* to;            // socket to write to
+        base::Buffer buf[2];        // double buffer, read into one while the other one is being written,
+                                    // borrowed from the pool only once the socket is readable
+        size_t len[2];              // pending bytes of each buffer, 0 means free
+        int readIdx;                // buffer index for next read
+        int writeIdx;               // buffer index being written
+        bool reading;               // async read in flight
+        bool writing;               // async write in flight
+        bool eof;                   // peer has half-closed
+        uint64_t bytes;             // bytes relayed
+        int pipe[2];                // splice mode: pipe between the two sockets
+        size_t piped;               // splice mode: bytes sitting in the pipe
+    };
 private:
     uint64_t sessionId_;            // sessionId for current session
 
@@ -38,8 +81,17 @@ private:
     tcp::socket outSocket_;
     tcp::resolver resolver_;        // dns async resolver
 
-    vector<char> inBuf_;
-    vector<char> outBuf_;
+    base::Buffer inBuf_;            // handshake buffer, given back once the relay starts
+
+    HandlerMemory handlerMemory_;   // completion handler state of all async operations
+    std::shared_ptr<Session> self_; // keeps the session alive during the relay phase
+    int pendingOps_;                // relay operations in flight
+
+    Flow flows_[2];
+    int closedFlows_;               // bitmask of directions already shut down
+    int relayMode_;                 // RelayMode actually used by this session
+
+    static int defaultRelayMode_;
 
     std::string remoteAddr_;
     std::string remotePort_;
@@ -7,10 +7,25 @@
 using namespace std;
 using namespace boost::asio::ip;
 
-Socks5Server::Socks5Server(io_service& ios, uint16_t listenPort) : \
-    port_(listenPort), serverName_(""), sessionId_(0), acceptor_(ios, tcp::endpoint(tcp::v4(), listenPort)),    // acceptor will bind && listen here
-    acceptSocket_(ios)
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+
+atomic_uint64_t Socks5Server::sessionId_(0);
+
+Socks5Server::Socks5Server(io_service& ios, uint16_t listenPort, bool reusePort) : \
+    port_(listenPort), serverName_(""), acceptor_(ios), acceptSocket_(ios)
 {
+    tcp::endpoint endpoint(tcp::v4(), listenPort);
+
+    // bind && listen here
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    if (reusePort) {
+        // kernel spreads incoming connections over all acceptors bound to this port
+        acceptor_.set_option(reuse_port(true));
+    }
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+
     LOG_DEBUG("Socks5Server[%s] object constructed!", serverName_.c_str());
     doAccept();
 }
@@ -27,10 +42,10 @@ void Socks5Server::doAccept()
     // no need to create a member function called handle_accept anymore, use lambda
     acceptor_.async_accept(acceptSocket_, [this] (boost::system::error_code ec) {   // use lambda function for handle
         if (!ec) {
-            this->sessionId_++;
+            uint64_t sessionId = ++sessionId_;
             LOG_DEBUG("accept success");
             // handle incoming connection, move socket object to session
-            auto session = std::make_shared<Session>(std::move(acceptSocket_), sessionId_);
+            auto session = std::make_shared<Session>(std::move(acceptSocket_), sessionId);
             session->start();
         } else {
             LOG_WARN("async_accept error! info: [%s]", ec.message().c_str());
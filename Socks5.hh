@@ -14,14 +14,15 @@ using boost::asio::ip::tcp;
 
 class Socks5Server {
 public:
-    Socks5Server(io_service& ios, uint16_t listenPort);
+    // reusePort: bind with SO_REUSEPORT so that every worker owns an acceptor on the same port
+    Socks5Server(io_service& ios, uint16_t listenPort, bool reusePort = false);
     ~Socks5Server();
 private:
     void doAccept();
 private:
     uint16_t port_;                 // listen port
     string serverName_;             // server instance name
-    atomic_uint64_t sessionId_;     // sessionId for incoming connection
+    static atomic_uint64_t sessionId_;  // sessionId for incoming connection, shared by all workers
 
     tcp::acceptor acceptor_;        // boost async acceptor
     tcp::socket acceptSocket_;      // accepted socket, will move to session
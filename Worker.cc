@@ -0,0 +1,51 @@
+#include "Worker.hh"
+#include "Log.hh"
+
+#include <pthread.h>
+#include <sched.h>
+
+Worker::Worker(int workerId, uint16_t listenPort, bool reusePort, int cpu) : workerId_(workerId), cpu_(cpu), \
+    ios_(1), server_(ios_, listenPort, reusePort)   // concurrency hint 1: io_service is only run by one thread
+{
+    LOG_DEBUG("Worker[%d] object constructed!", workerId_);
+}
+
+Worker::~Worker()
+{
+    LOG_DEBUG("Worker[%d] object destructed!", workerId_);
+}
+
+void Worker::start()
+{
+    thread_ = std::thread(&Worker::run, this);
+}
+
+void Worker::stop()
+{
+    ios_.stop();
+}
+
+void Worker::join()
+{
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void Worker::run()
+{
+    if (cpu_ >= 0) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu_, &cpuSet);
+
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+        if (ret != 0) {
+            LOG_WARN("Worker[%d] failed to set affinity to cpu [%d], error: [%d]", workerId_, cpu_, ret);
+        }
+    }
+
+    LOG_DEBUG("Worker[%d] running, cpu: [%d]", workerId_, cpu_);
+    ios_.run();
+    LOG_DEBUG("Worker[%d] quit!", workerId_);
+}
@@ -0,0 +1,34 @@
+#ifndef __WORKER_HH__
+#define __WORKER_HH__
+
+#include "Socks5.hh"
+
+#include <cstdint>
+#include <thread>
+
+#include <boost/asio.hpp>
+
+using boost::asio::io_service;
+
+// one io_service per thread, sessions accepted by a worker never leave its thread
+class Worker {
+public:
+    // cpu: pin worker thread to this cpu, -1 means no affinity
+    Worker(int workerId, uint16_t listenPort, bool reusePort, int cpu = -1);
+    ~Worker();
+
+    void start();   // run io_service on a new thread
+    void stop();
+    void join();
+private:
+    void run();
+private:
+    int workerId_;
+    int cpu_;
+
+    io_service ios_;
+    Socks5Server server_;
+    std::thread thread_;
+};
+
+#endif
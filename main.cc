@@ -1,8 +1,18 @@
 #include "Log.hh"
+#include "BufferPool.hh"
 #include "Socks5.hh"
+#include "Session.hh"
+#include "Worker.hh"
 
 #include <iostream>
 #include <string>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <thread>
+
+#include <unistd.h>
 
 #include <boost/asio.hpp>
 #include <boost/asio/signal_set.hpp>
@@ -14,21 +24,63 @@ int main(int argc, char* argv[])
 {
     LOG_DEBUG("socks5-asio");
     LOG_DEBUG("main begin!");
-    // io_service object
+
+    int workerCnt = 1;
+    bool pinCpu = false;
+
+    // -m splice|buffered: relay mode for the data phase
+    // -w N: number of worker threads, each with its own io_service and acceptor
+    // -a: pin worker N to cpu N
+    int opt;
+    while ((opt = getopt(argc, argv, "m:w:a")) != -1) {
+        if (opt == 'm' && strcmp(optarg, "buffered") == 0) {
+            Session::SetRelayMode(RELAY_BUFFERED);
+        } else if (opt == 'm' && strcmp(optarg, "splice") == 0) {
+            Session::SetRelayMode(RELAY_SPLICE);
+        } else if (opt == 'w' && atoi(optarg) > 0) {
+            workerCnt = atoi(optarg);
+        } else if (opt == 'a') {
+            pinCpu = true;
+        } else {
+            cerr << "usage: " << argv[0] << " [-m splice|buffered] [-w workers] [-a]" << endl;
+            return 1;
+        }
+    }
+
+    // io_service object, only handles signals, sessions live on workers
     io_service ios;
 
-    // server class object
-    Socks5Server server(ios, 8099);
+    // workers, each one with its own SO_REUSEPORT acceptor when more than one
+    int cpuCnt = std::thread::hardware_concurrency();
+    vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < workerCnt; i += 1) {
+        int cpu = (pinCpu && cpuCnt > 0) ? i % cpuCnt : -1;
+        workers.emplace_back(new Worker(i, 8099, workerCnt > 1, cpu));
+    }
+    for (auto& worker : workers) {
+        worker->start();
+    }
 
     // handle signals
     boost::asio::signal_set signals(ios, SIGINT);
-    signals.async_wait([&ios] (const boost::system::error_code& error , int sigNum) {
+    signals.async_wait([&ios, &workers] (const boost::system::error_code& error , int sigNum) {
         LOG_WARN("signal [%d] catched! will quit!", sigNum);
+        for (auto& worker : workers) {
+            worker->stop();
+        }
         ios.stop();
     });
 
     // block forever until all callback finished
     ios.run();
+    for (auto& worker : workers) {
+        worker->join();
+    }
+
+    uint64_t poolHits = 0;
+    uint64_t poolMisses = 0;
+    base::BufferPool::GetStats(poolHits, poolMisses);
+    LOG_INFO("buffer pool hits: [%llu], misses: [%llu]", poolHits, poolMisses);
     LOG_DEBUG("main end!");
     return 0;
 }
\ No newline at end of file